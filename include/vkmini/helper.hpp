@@ -1,28 +1,20 @@
 #ifndef VK_HELPER_HPP
 #define VK_HELPER_HPP
 
+// Chooses `DefaultThreading`. This does not change the library itself, but it
+// changes the aliases in `vkmini.hpp`, so it has to be the same in every file
+// of a program
 #ifndef VKMINI_MULTITHREAD
 #define VKMINI_MULTITHREAD true
 #endif
 
-#if VKMINI_MULTITHREAD
-#define VKMINI_IF_MULTITHREAD(x) x
-#define VKMINI_INSIDE_LOCK(x)                                                                                          \
-	while (!Ctx::globalMutex.try_lock()) {                                                                               \
-	}                                                                                                                    \
-	x Ctx::globalMutex.unlock();
-#else
-#define VKMINI_IF_MULTITHREAD(x)
-#define VKMINI_INSIDE_LOCK(x) x
-#include <mutex>
-#endif
-
 #include <boost/assert/source_location.hpp>
 #include <boost/stacktrace/stacktrace.hpp>
 #include <cstdint>
 #include <filesystem>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -57,6 +49,54 @@ template <typename A, typename B> using Pair = std::pair<A, B>;
 
 static const auto None = std::nullopt;
 
+/// A mutex that does nothing. `SingleThread` uses this so that locking
+/// compiles down to nothing
+struct NoMutex {
+	constexpr void lock() noexcept {}
+	constexpr bool try_lock() noexcept { return true; }
+	constexpr void unlock() noexcept {}
+};
+
+/// Threading policy for contexts and resources that can be used by several
+/// threads. There is one registry for the whole program, and its updates are
+/// protected by a `std::mutex`
+struct MultiThread {
+	using Mutex = std::mutex;
+
+	template <typename T> static T& registry() {
+		static T value{};
+		return value;
+	}
+};
+
+/// Threading policy for contexts and resources that are used by just one
+/// thread. There is no synchronization cost.
+/// Every thread has its own registry, so single-threaded parts of a program
+/// can run on different threads. A context and all resources created with it
+/// have to stay on the thread that created the context. Each such thread has
+/// to call `vk::cleanup` before it exits, which cleans up the `SingleThread`
+/// objects of that thread only
+struct SingleThread {
+	using Mutex = NoMutex;
+
+	template <typename T> static T& registry() {
+		thread_local T value{};
+		return value;
+	}
+};
+
+/// The threading policy used by the `CtxTy`, `BufferTy`, `BufferGroupTy` and
+/// `CommandBufferTy` aliases. A program that mixes policies has to use the
+/// `Basic` templates with an explicit policy, not different values of
+/// `VKMINI_MULTITHREAD`
+#if VKMINI_MULTITHREAD
+using DefaultThreading = MultiThread;
+#else
+using DefaultThreading = SingleThread;
+#endif
+
+template <typename Th> using LockGuard = std::lock_guard<typename Th::Mutex>;
+
 class Slice {
 	u8*   ptr;
 	usize length;
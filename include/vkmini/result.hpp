@@ -18,6 +18,7 @@ enum ErrorCode {
 	VKMINI_BUFFER_SIZE_MISMATCH,
 	VKMINI_FAILED_TO_CREATE_BUFFER,
 	VKMINI_FAILED_TO_ALLOCATE_BUFFER_MEMORY,
+	VKMINI_FAILED_TO_BIND_BUFFER_MEMORY,
 
 	VKMINI_FAILED_TO_FIND_SUITABLE_MEMORY_TYPE,
 
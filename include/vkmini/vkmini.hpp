@@ -3,9 +3,6 @@
 
 #include <vkmini/helper.hpp>
 
-#if VKMINI_MULTITHREAD
-#endif
-
 #include <functional>
 #include <mutex>
 #include <optional>
@@ -20,21 +17,32 @@
 namespace vk {
 
 /// Always call this function before quitting the program, before cleaning up
-/// other Vulkan resources created by you
+/// other Vulkan resources created by you. This cleans up all `MultiThread`
+/// resources, and the `SingleThread` resources created by the calling thread
 void cleanup();
 
-class CtxTy;
-using Ctx = CtxTy const*;
-
-/// `CtxType` is used to represent common values of datatypes that are used
-/// commonly by functions in this library
-class CtxTy {
-	friend class BufferTy;
-	friend class CommandBufferTy;
-	static std::vector<Ctx> allContexts;
-	VKMINI_IF_MULTITHREAD(static std::mutex globalMutex;)
+template <typename Th> class BasicCtxTy;
+template <typename Th> using BasicCtx = BasicCtxTy<Th> const*;
+
+template <typename Th> class BasicBufferTy;
+template <typename Th> class BasicBufferGroupTy;
+template <typename Th> class BasicCommandBufferTy;
+
+/// `BasicCtxTy` is used to represent common values of datatypes that are used
+/// commonly by functions in this library.
+/// `Th` is the threading policy, either `MultiThread` or `SingleThread`.
+/// Contexts and resources of different policies have separate registries and
+/// locks, so both can be used in the same program
+template <typename Th> class BasicCtxTy {
+	friend class BasicBufferTy<Th>;
+	friend class BasicBufferGroupTy<Th>;
+	friend class BasicCommandBufferTy<Th>;
+	static std::vector<BasicCtx<Th>>& all_contexts() {
+		return Th::template registry<std::vector<BasicCtx<Th>>>();
+	}
+	static typename Th::Mutex globalMutex;
 
-	CtxTy(VkPhysicalDevice _physical, VkDevice _logical, VkQueue _graphicsQueue, VkCommandPool _commandPool)
+	BasicCtxTy(VkPhysicalDevice _physical, VkDevice _logical, VkQueue _graphicsQueue, VkCommandPool _commandPool)
 	    : physical(_physical), logical(_logical), graphicsQueue(_graphicsQueue), commandPool(_commandPool) {}
 
 public:
@@ -43,25 +51,32 @@ public:
 	VkQueue          graphicsQueue;
 	VkCommandPool    commandPool;
 
-	/// Create a `Ctx` in a thread-safe manner. This uses a mutex lock to make
-	/// this thread-safe.
-	static Ctx create(VkPhysicalDevice physical, VkDevice logical, VkQueue graphicsQueue, VkCommandPool commandPool) {
-		auto res = new CtxTy(physical, logical, graphicsQueue, commandPool);
-		VKMINI_INSIDE_LOCK(allContexts.push_back(res);)
+	/// Create a `Ctx`. This is thread-safe if the threading policy is
+	/// `MultiThread`
+	static BasicCtx<Th> create(VkPhysicalDevice physical, VkDevice logical, VkQueue graphicsQueue,
+	                           VkCommandPool commandPool) {
+		auto res = new BasicCtxTy(physical, logical, graphicsQueue, commandPool);
+		{
+			LockGuard<Th> lock(globalMutex);
+			all_contexts().push_back(res);
+		}
 		return res;
 	}
 
 	static void cleanup();
 };
 
-class WithCtx {
+using CtxTy = BasicCtxTy<DefaultThreading>;
+using Ctx   = BasicCtx<DefaultThreading>;
+
+template <typename Th> class WithCtx {
 protected:
-	Ctx ctx;
+	BasicCtx<Th> ctx;
 
-	WithCtx(Ctx _ctx) : ctx(_ctx) {}
+	WithCtx(BasicCtx<Th> _ctx) : ctx(_ctx) {}
 
 public:
-	use Ctx get_ctx() const { return ctx; }
+	use BasicCtx<Th> get_ctx() const { return ctx; }
 };
 
 /// Used to find the appropriate memory types for buffers, based on
@@ -69,30 +84,75 @@ public:
 /// Potential `typeFilter` value can be the `memoryTypeBits` field of
 /// `VkMemoryRequirements` which is obtained using
 /// `vkGetBufferMemoryRequirements`
-use Maybe<u32> find_memory_type(Ctx ctx, u32 typeFilter, VkMemoryPropertyFlags properties);
+template <typename Th>
+use Maybe<u32> find_memory_type(BasicCtx<Th> ctx, u32 typeFilter, VkMemoryPropertyFlags properties);
+
+/// The synchronization state of a buffer, as tracked by
+/// `cmd_sync_buffer_accesses`. All fields are empty until the buffer is first
+/// accessed
+struct BufferAccessState {
+	/// Stages and access types of the last write
+	VkPipelineStageFlags writeStages = 0;
+	VkAccessFlags        writeAccess = 0;
+	/// Stages that read from the buffer after the last write
+	VkPipelineStageFlags readStages = 0;
+	/// Stages and access types that the last write has been made visible to
+	VkPipelineStageFlags visibleStages = 0;
+	VkAccessFlags        visibleAccess = 0;
+	/// The range of bytes covered by all accesses so far
+	VkDeviceSize offset = 0;
+	VkDeviceSize size   = 0;
+};
 
-class BufferTy;
-using Buffer = BufferTy const*;
+/// An intended access to a range of a buffer. Use `declare_access` of a
+/// `Buffer` to get this value
+struct BufferAccess {
+	VkBuffer             buffer;
+	BufferAccessState*   state;
+	VkPipelineStageFlags stages;
+	VkAccessFlags        access;
+	VkDeviceSize         offset;
+	VkDeviceSize         size;
+};
 
-class BufferTy : public WithCtx {
-	friend class CtxTy;
-	static std::vector<Buffer> allBuffers;
+/// Record the buffer memory barriers required before the given accesses, as a
+/// single `vkCmdPipelineBarrier`. Nothing is recorded if no barrier is
+/// required. Accesses to the same buffer are merged and treated as one access.
+/// Accesses have to be declared in the order that they are submitted, and
+/// tracking assumes that a buffer is only used by queues of one family.
+/// Queue family ownership transfers are not handled here: record the release
+/// and acquire barriers by hand. The state of a buffer is not locked, so like
+/// a `VkCommandBuffer`, a buffer should only be used here by one thread at a
+/// time
+void cmd_sync_buffer_accesses(VkCommandBuffer commandBuffer, Vec<BufferAccess> const& accesses);
+
+template <typename Th> using BasicBuffer = BasicBufferTy<Th> const*;
+
+template <typename Th> class BasicBufferTy : public WithCtx<Th> {
+	friend class BasicCtxTy<Th>;
+	static std::vector<BasicBuffer<Th>>& all_buffers() {
+		return Th::template registry<std::vector<BasicBuffer<Th>>>();
+	}
+
+	using WithCtx<Th>::ctx;
 
 	VkDeviceSize   size;
 	VkBuffer       buffer;
 	VkDeviceMemory memory;
 	void*          mapping;
 
-	BufferTy(Ctx _ctx, VkDeviceSize _size, VkBuffer _buffer, VkDeviceMemory _memory)
-	    : WithCtx(_ctx), size(_size), buffer(_buffer), memory(_memory) {}
+	mutable BufferAccessState accessState;
+
+	BasicBufferTy(BasicCtx<Th> _ctx, VkDeviceSize _size, VkBuffer _buffer, VkDeviceMemory _memory)
+	    : WithCtx<Th>(_ctx), size(_size), buffer(_buffer), memory(_memory) {}
 
 public:
 	/// Create a `Buffer`.
 	/// Can return errors:
 	/// `VKMINI_FAILED_TO_CREATE_BUFFER`,
 	/// `VKMINI_FAILED_TO_ALLOCATE_BUFFER_MEMORY`
-	use static Result<Buffer, ErrorPair> create(Ctx ctx, VkDeviceSize size, VkBufferUsageFlags usage,
-	                                            VkMemoryPropertyFlags flags);
+	use static Result<BasicBuffer<Th>, ErrorPair> create(BasicCtx<Th> ctx, VkDeviceSize size, VkBufferUsageFlags usage,
+	                                                     VkMemoryPropertyFlags flags);
 
 	/// Get the intended size of this buffer
 	use VkDeviceSize get_size() const { return size; }
@@ -127,8 +187,22 @@ public:
 	/// Can return error `VKMINI_FAILED_TO_MAP_MEMORY`
 	use ErrorPair copy_unchecked_from(void* data);
 
+	/// Declare an intended access to `range` bytes of this buffer, starting at
+	/// `offset`. Pass this to `cmd_sync_buffer_accesses` or to `sync_accesses`
+	/// of a `CommandBuffer`
+	use BufferAccess declare_access(VkPipelineStageFlags stages, VkAccessFlags access, VkDeviceSize offset = 0,
+	                                VkDeviceSize range = VK_WHOLE_SIZE) const {
+		return {buffer, &accessState, stages, access, offset, range == VK_WHOLE_SIZE ? size - offset : range};
+	}
+
+	/// Get the tracked synchronization state of this buffer
+	use BufferAccessState const& get_access_state() const { return accessState; }
+
 	/// Copy contents of this buffer to another `VkBuffer` without checking
 	/// if the size matches.
+	/// The write to `destination` is not tracked. If the destination is
+	/// tracked, use the overload taking a `BufferAccess` instead, or declare a
+	/// transfer write on it yourself.
 	/// Can return errors:
 	/// `VKMINI_FAILED_TO_ALLOCATE_COMMAND_BUFFER`,
 	/// `VKMINI_FAILED_TO_BEGIN_COMMAND_BUFFER`,
@@ -137,6 +211,19 @@ public:
 	/// `VKMINI_FAILED_WAITING_FOR_QUEUE_TO_FINISH`
 	use ErrorPair copy_to_vk_buffer_unchecked(VkBuffer destination) const;
 
+	/// Copy contents of this buffer to a tracked buffer without checking if
+	/// the size matches, such as a member of a `BufferGroup`. Get
+	/// `destination` using `declare_access` of the destination. The copy is
+	/// tracked as a transfer write to the first `get_size()` bytes of the
+	/// destination, whatever stages, access and range were declared.
+	/// Can return errors:
+	/// `VKMINI_FAILED_TO_ALLOCATE_COMMAND_BUFFER`,
+	/// `VKMINI_FAILED_TO_BEGIN_COMMAND_BUFFER`,
+	/// `VKMINI_FAILED_TO_END_COMMAND_BUFFER`,
+	/// `VKMINI_FAILED_TO_SUBMIT_COMMAND_BUFFER`,
+	/// `VKMINI_FAILED_WAITING_FOR_QUEUE_TO_FINISH`
+	use ErrorPair copy_to_vk_buffer_unchecked(BufferAccess destination) const;
+
 	/// Copy contents of this buffer to another `Buffer`. The size of these
 	/// buffers should be equal.
 	/// Can return errors:
@@ -146,13 +233,101 @@ public:
 	/// `VKMINI_FAILED_TO_END_COMMAND_BUFFER`,
 	/// `VKMINI_FAILED_TO_SUBMIT_COMMAND_BUFFER`,
 	/// `VKMINI_FAILED_WAITING_FOR_QUEUE_TO_FINISH`
-	use ErrorPair copy_to(BufferTy destination) const;
+	use ErrorPair copy_to(BasicBuffer<Th> destination) const;
+
+	~BasicBufferTy();
+
+private:
+	use ErrorPair copy_to_vk_buffer(VkBuffer destination, Maybe<BufferAccess> destinationAccess) const;
+};
+
+using BufferTy = BasicBufferTy<DefaultThreading>;
+using Buffer   = BasicBuffer<DefaultThreading>;
+
+/// Describes one buffer to be created as part of a `BufferGroup`
+struct BufferSpec {
+	VkDeviceSize          size;
+	VkBufferUsageFlags    usage;
+	VkMemoryPropertyFlags flags;
+};
 
-	~BufferTy();
+template <typename Th> using BasicBufferGroup = BasicBufferGroupTy<Th> const*;
+
+/// A group of buffers that are created and destroyed together. Buffers that
+/// use the same memory type share a `VkDeviceMemory`. The handles, offsets
+/// and sizes are stored in separate arrays, where the index of a buffer is the
+/// index of its `BufferSpec`
+template <typename Th> class BasicBufferGroupTy : public WithCtx<Th> {
+	friend class BasicCtxTy<Th>;
+	static std::vector<BasicBufferGroup<Th>>& all_buffer_groups() {
+		return Th::template registry<std::vector<BasicBufferGroup<Th>>>();
+	}
+
+	using WithCtx<Th>::ctx;
+
+	Vec<VkBuffer>       buffers;
+	Vec<VkDeviceSize>   offsets;
+	Vec<VkDeviceSize>   sizes;
+	Vec<u32>            memoryIndices;
+	Vec<VkDeviceMemory> memories;
+
+	mutable Vec<BufferAccessState> accessStates;
+
+	BasicBufferGroupTy(BasicCtx<Th> _ctx) : WithCtx<Th>(_ctx) {}
+
+public:
+	/// Create a `BufferGroup` with one buffer for every `BufferSpec`. Buffers
+	/// of the same memory type share one memory allocation. Another allocation
+	/// is only made when an allocation would exceed the
+	/// `maxMemoryAllocationSize` of the device.
+	/// This requires Vulkan 1.1, since the buffers are bound using
+	/// `vkBindBufferMemory2`.
+	/// Can return errors:
+	/// `VKMINI_FAILED_TO_CREATE_BUFFER`,
+	/// `VKMINI_FAILED_TO_FIND_SUITABLE_MEMORY_TYPE`,
+	/// `VKMINI_FAILED_TO_ALLOCATE_BUFFER_MEMORY`,
+	/// `VKMINI_FAILED_TO_BIND_BUFFER_MEMORY`
+	use static Result<BasicBufferGroup<Th>, ErrorPair> create(BasicCtx<Th> ctx, Vec<BufferSpec> const& specs);
+
+	/// Get the number of buffers in this group
+	use usize get_count() const { return buffers.size(); }
+
+	/// Get the underlying `VkBuffer` of every buffer in this group
+	use Vec<VkBuffer> const& get_buffers() const { return buffers; }
+
+	/// Get the offset of every buffer in its `VkDeviceMemory`
+	use Vec<VkDeviceSize> const& get_offsets() const { return offsets; }
+
+	/// Get the intended size of every buffer in this group
+	use Vec<VkDeviceSize> const& get_sizes() const { return sizes; }
+
+	/// Get the underlying `VkBuffer` of the buffer at `index`
+	use VkBuffer get_buffer(usize index) const { return buffers[index]; }
+
+	/// Get the offset of the buffer at `index` in its `VkDeviceMemory`
+	use VkDeviceSize get_offset(usize index) const { return offsets[index]; }
+
+	/// Get the intended size of the buffer at `index`
+	use VkDeviceSize get_size(usize index) const { return sizes[index]; }
+
+	/// Get the `VkDeviceMemory` that the buffer at `index` is bound to
+	use VkDeviceMemory get_memory(usize index) const { return memories[memoryIndices[index]]; }
+
+	/// Declare an intended access to the buffer at `index`. See
+	/// `declare_access` of `Buffer`
+	use BufferAccess declare_access(usize index, VkPipelineStageFlags stages, VkAccessFlags access,
+	                                VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) const {
+		auto size = (range == VK_WHOLE_SIZE) ? sizes[index] - offset : range;
+		return {buffers[index], &accessStates[index], stages, access, offset, size};
+	}
+
+	~BasicBufferGroupTy();
 };
 
-class CommandBufferTy;
-using CommandBuffer = CommandBufferTy const*;
+using BufferGroupTy = BasicBufferGroupTy<DefaultThreading>;
+using BufferGroup   = BasicBufferGroup<DefaultThreading>;
+
+template <typename Th> using BasicCommandBuffer = BasicCommandBufferTy<Th> const*;
 
 enum class CommandBufferState {
 	BEGUN,
@@ -161,20 +336,24 @@ enum class CommandBufferState {
 	NONE,
 };
 
-class CommandBufferTy : public WithCtx {
-	friend class CtxTy;
-	static std::vector<CommandBuffer> allCommandBuffers;
+template <typename Th> class BasicCommandBufferTy : public WithCtx<Th> {
+	friend class BasicCtxTy<Th>;
+	static std::vector<BasicCommandBuffer<Th>>& all_command_buffers() {
+		return Th::template registry<std::vector<BasicCommandBuffer<Th>>>();
+	}
+
+	using WithCtx<Th>::ctx;
 
 	VkCommandBuffer    buffer;
 	CommandBufferState state;
 
-	CommandBufferTy(Ctx _ctx, VkCommandBuffer _buffer) : WithCtx(_ctx), buffer(_buffer) {}
+	BasicCommandBufferTy(BasicCtx<Th> _ctx, VkCommandBuffer _buffer) : WithCtx<Th>(_ctx), buffer(_buffer) {}
 
 public:
 	/// Create a `CommandBuffer`
 	/// Can return error `VKMINI_FAILED_TO_ALLOCATE_COMMAND_BUFFER`
-	use static Result<CommandBuffer, ErrorPair> create(Ctx                  ctx,
-	                                                   VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	use static Result<BasicCommandBuffer<Th>, ErrorPair>
+	    create(BasicCtx<Th> ctx, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
 	/// Get the underlying `VkCommandBuffer`
 	use VkCommandBuffer get_buffer() const { return buffer; }
@@ -185,6 +364,10 @@ public:
 	/// Record commands to the buffer. The commands won't be executed.
 	use ErrorCode record(std::function<void(VkCommandBuffer)> callback);
 
+	/// Record the barriers required before the given buffer accesses. See
+	/// `cmd_sync_buffer_accesses`
+	use ErrorCode sync_accesses(Vec<BufferAccess> const& accesses);
+
 	/// End recording to the command buffer
 	use ErrorPair end();
 
@@ -198,9 +381,23 @@ public:
 	use ErrorPair perform(std::function<void(VkCommandBuffer)> callback, VkQueue graphicsQueue,
 	                      VkCommandBufferUsageFlags beginFlags = 0, VkFence fence = VK_NULL_HANDLE);
 
-	~CommandBufferTy();
+	~BasicCommandBufferTy();
 };
 
+using CommandBufferTy = BasicCommandBufferTy<DefaultThreading>;
+using CommandBuffer   = BasicCommandBuffer<DefaultThreading>;
+
+// Only the `MultiThread` and `SingleThread` policies are compiled into the
+// library
+extern template class BasicCtxTy<MultiThread>;
+extern template class BasicCtxTy<SingleThread>;
+extern template class BasicBufferTy<MultiThread>;
+extern template class BasicBufferTy<SingleThread>;
+extern template class BasicBufferGroupTy<MultiThread>;
+extern template class BasicBufferGroupTy<SingleThread>;
+extern template class BasicCommandBufferTy<MultiThread>;
+extern template class BasicCommandBufferTy<SingleThread>;
+
 } // namespace vk
 
 #endif
@@ -1,33 +1,40 @@
+#include <algorithm>
 #include <cstring>
 #include <vkmini/vkmini.hpp>
 #include <vulkan/vulkan_core.h>
 
 namespace vk {
 
-VKMINI_IF_MULTITHREAD(std::mutex CtxTy::globalMutex{};)
-std::vector<Ctx>           CtxTy::allContexts{};
-std::vector<Buffer>        BufferTy::allBuffers{};
-std::vector<CommandBuffer> CommandBufferTy::allCommandBuffers{};
+template <typename Th> typename Th::Mutex BasicCtxTy<Th>::globalMutex{};
 
-void CtxTy::cleanup() {
-	VKMINI_INSIDE_LOCK({
-		for (auto ptr : CtxTy::allContexts) {
-			delete ptr;
-		}
-		for (auto ptr : BufferTy::allBuffers) {
-			delete ptr;
-		}
-		for (auto ptr : CommandBufferTy::allCommandBuffers) {
-			delete ptr;
-		}
-	});
+template <typename Th> void BasicCtxTy<Th>::cleanup() {
+	LockGuard<Th> lock(globalMutex);
+	// Resources are destroyed before the contexts that they refer to
+	for (auto ptr : BasicBufferTy<Th>::all_buffers()) {
+		delete ptr;
+	}
+	BasicBufferTy<Th>::all_buffers().clear();
+	for (auto ptr : BasicBufferGroupTy<Th>::all_buffer_groups()) {
+		delete ptr;
+	}
+	BasicBufferGroupTy<Th>::all_buffer_groups().clear();
+	for (auto ptr : BasicCommandBufferTy<Th>::all_command_buffers()) {
+		delete ptr;
+	}
+	BasicCommandBufferTy<Th>::all_command_buffers().clear();
+	for (auto ptr : all_contexts()) {
+		delete ptr;
+	}
+	all_contexts().clear();
 }
 
-void cleanup() { CtxTy::cleanup(); }
+void cleanup() {
+	BasicCtxTy<MultiThread>::cleanup();
+	BasicCtxTy<SingleThread>::cleanup();
+}
 
-std::optional<uint32_t> find_memory_type(Ctx ctx, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(ctx->physical, &memProperties);
+static Maybe<u32> find_memory_type_in(VkPhysicalDeviceMemoryProperties const& memProperties, u32 typeFilter,
+                                      VkMemoryPropertyFlags properties) {
 	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
 		if ((typeFilter & (1 << i)) && ((memProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
 			return i;
@@ -36,8 +43,129 @@ std::optional<uint32_t> find_memory_type(Ctx ctx, uint32_t typeFilter, VkMemoryP
 	return None;
 }
 
-Result<Buffer, ErrorPair> BufferTy::create(Ctx ctx, VkDeviceSize size, VkBufferUsageFlags usage,
-                                           VkMemoryPropertyFlags properties) {
+template <typename Th>
+std::optional<uint32_t> find_memory_type(BasicCtx<Th> ctx, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(ctx->physical, &memProperties);
+	return find_memory_type_in(memProperties, typeFilter, properties);
+}
+
+static constexpr VkAccessFlags WRITE_ACCESS_MASK =
+    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT |
+    VK_ACCESS_TRANSFORM_FEEDBACK_WRITE_BIT_EXT | VK_ACCESS_TRANSFORM_FEEDBACK_COUNTER_WRITE_BIT_EXT |
+    VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+static bool ranges_overlap(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB, VkDeviceSize sizeB) {
+	return (offsetA < offsetB + sizeB) && (offsetB < offsetA + sizeA);
+}
+
+static void merge_range(VkDeviceSize& offset, VkDeviceSize& size, VkDeviceSize otherOffset, VkDeviceSize otherSize) {
+	if (size == 0) {
+		offset = otherOffset;
+		size   = otherSize;
+		return;
+	}
+	auto end = std::max(offset + size, otherOffset + otherSize);
+	offset   = std::min(offset, otherOffset);
+	size     = end - offset;
+}
+
+void cmd_sync_buffer_accesses(VkCommandBuffer commandBuffer, Vec<BufferAccess> const& accesses) {
+	// Accesses to the same buffer are merged, so that a buffer gets at most one
+	// barrier
+	Vec<BufferAccess> merged;
+	merged.reserve(accesses.size());
+	for (auto const& access : accesses) {
+		auto existing = std::find_if(merged.begin(), merged.end(),
+		                             [&](BufferAccess const& other) { return other.state == access.state; });
+		if (existing == merged.end()) {
+			merged.push_back(access);
+			continue;
+		}
+		merge_range(existing->offset, existing->size, access.offset, access.size);
+		existing->stages |= access.stages;
+		existing->access |= access.access;
+	}
+
+	VkPipelineStageFlags       srcStages = 0;
+	VkPipelineStageFlags       dstStages = 0;
+	Vec<VkBufferMemoryBarrier> barriers;
+	for (auto const& access : merged) {
+		auto&      state    = *access.state;
+		const bool isWrite  = (access.access & WRITE_ACCESS_MASK) != 0;
+		const bool isRead   = (access.access & ~WRITE_ACCESS_MASK) != 0;
+		const bool overlaps = (state.size != 0) && ranges_overlap(state.offset, state.size, access.offset, access.size);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer              = access.buffer;
+		barrier.offset              = access.offset;
+		barrier.size                = access.size;
+		barrier.dstAccessMask       = access.access;
+		VkPipelineStageFlags waitStages    = 0;
+		VkPipelineStageFlags blockedStages = access.stages;
+		bool                 needed        = false;
+		if (overlaps && isWrite) {
+			// Write after write or write after read. The barrier also covers earlier
+			// writes outside this range, since the state only keeps the latest write
+			waitStages            = state.writeStages | state.readStages;
+			barrier.srcAccessMask = state.writeAccess;
+			merge_range(barrier.offset, barrier.size, state.offset, state.size);
+			needed = waitStages != 0;
+		} else if (overlaps && (state.writeAccess != 0) &&
+		           (((access.stages & ~state.visibleStages) != 0) || ((access.access & ~state.visibleAccess) != 0))) {
+			// Read after write, that is not visible to this access yet. Stages that
+			// already see the write, and the whole tracked range, are included so
+			// that the visible state holds for the entire buffer
+			waitStages            = state.writeStages;
+			barrier.srcAccessMask = state.writeAccess;
+			barrier.dstAccessMask |= state.visibleAccess;
+			blockedStages |= state.visibleStages;
+			merge_range(barrier.offset, barrier.size, state.offset, state.size);
+			needed = true;
+		}
+		if (needed) {
+			srcStages |= waitStages;
+			dstStages |= blockedStages;
+			barriers.push_back(barrier);
+		}
+
+		if (isWrite) {
+			if (overlaps || (state.size == 0)) {
+				state.writeStages = access.stages;
+				state.writeAccess = access.access & WRITE_ACCESS_MASK;
+				state.readStages  = isRead ? access.stages : 0;
+			} else {
+				state.writeStages |= access.stages;
+				state.writeAccess |= access.access & WRITE_ACCESS_MASK;
+				state.readStages |= isRead ? access.stages : 0;
+			}
+			state.visibleStages = 0;
+			state.visibleAccess = 0;
+		} else {
+			state.readStages |= access.stages;
+			if (needed) {
+				state.visibleStages = blockedStages;
+				state.visibleAccess = barrier.dstAccessMask;
+			}
+		}
+		merge_range(state.offset, state.size, access.offset, access.size);
+	}
+
+	if (barriers.empty()) {
+		return;
+	}
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, (u32)barriers.size(), barriers.data(), 0,
+	                     nullptr);
+}
+
+template <typename Th>
+Result<BasicBuffer<Th>, ErrorPair> BasicBufferTy<Th>::create(BasicCtx<Th> ctx, VkDeviceSize size,
+                                                             VkBufferUsageFlags    usage,
+                                                             VkMemoryPropertyFlags properties) {
 	VkBuffer       buffer;
 	VkDeviceMemory memory;
 
@@ -48,7 +176,7 @@ Result<Buffer, ErrorPair> BufferTy::create(Ctx ctx, VkDeviceSize size, VkBufferU
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	auto res               = vkCreateBuffer(ctx->logical, &bufferInfo, nullptr, &buffer);
 	if (res != VK_SUCCESS) {
-		return Result<Buffer, ErrorPair>::Error({res, VKMINI_FAILED_TO_CREATE_BUFFER});
+		return Result<BasicBuffer<Th>, ErrorPair>::Error({res, VKMINI_FAILED_TO_CREATE_BUFFER});
 	}
 
 	VkMemoryRequirements memReq;
@@ -60,22 +188,142 @@ Result<Buffer, ErrorPair> BufferTy::create(Ctx ctx, VkDeviceSize size, VkBufferU
 	if (memTy.has_value()) {
 		allocInfo.memoryTypeIndex = memTy.value();
 	} else {
-		return Result<Buffer, ErrorPair>::Error({VK_ERROR_UNKNOWN, VKMINI_FAILED_TO_FIND_SUITABLE_MEMORY_TYPE});
+		return Result<BasicBuffer<Th>, ErrorPair>::Error({VK_ERROR_UNKNOWN, VKMINI_FAILED_TO_FIND_SUITABLE_MEMORY_TYPE});
 	}
 	res = vkAllocateMemory(ctx->logical, &allocInfo, nullptr, &memory);
 	if (res != VK_SUCCESS) {
-		return Result<Buffer, ErrorPair>::Error({res, VKMINI_FAILED_TO_ALLOCATE_BUFFER_MEMORY});
+		return Result<BasicBuffer<Th>, ErrorPair>::Error({res, VKMINI_FAILED_TO_ALLOCATE_BUFFER_MEMORY});
 	}
 
 	vkBindBufferMemory(ctx->logical, buffer, memory, 0);
-	auto bufferResult = new BufferTy(ctx, size, buffer, memory);
+	auto bufferResult = new BasicBufferTy(ctx, size, buffer, memory);
+	{
+		LockGuard<Th> lock(BasicCtxTy<Th>::globalMutex);
+		all_buffers().push_back(bufferResult);
+	}
 
-	VKMINI_INSIDE_LOCK(allBuffers.push_back(bufferResult);)
+	return Result<BasicBuffer<Th>, ErrorPair>::Ok(bufferResult);
+}
+
+template <typename Th>
+Result<BasicBufferGroup<Th>, ErrorPair> BasicBufferGroupTy<Th>::create(BasicCtx<Th>           ctx,
+                                                                       Vec<BufferSpec> const& specs) {
+	using ResultTy = Result<BasicBufferGroup<Th>, ErrorPair>;
+	// Partially created groups are deleted on failure, which destroys the
+	// buffers and memory created so far
+	auto group = new BasicBufferGroupTy(ctx);
+	group->buffers.reserve(specs.size());
+	group->offsets.reserve(specs.size());
+	group->sizes.reserve(specs.size());
+	group->memoryIndices.reserve(specs.size());
+
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(ctx->physical, &memProperties);
 
-	return Result<Buffer, ErrorPair>::Ok(bufferResult);
+	VkPhysicalDeviceMaintenance3Properties maintenance3{};
+	maintenance3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+	VkPhysicalDeviceProperties2 deviceProperties{};
+	deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperties.pNext = &maintenance3;
+	vkGetPhysicalDeviceProperties2(ctx->physical, &deviceProperties);
+
+	// Buffers are packed in the order of the specs, into the first allocation
+	// of their memory type that stays within `maxMemoryAllocationSize`. A new
+	// allocation is only started if none of them has room
+	Vec<u32>          allocationTypes;
+	Vec<VkDeviceSize> allocationSizes;
+	for (auto const& spec : specs) {
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size        = spec.size;
+		bufferInfo.usage       = spec.usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkBuffer buffer;
+		auto     res = vkCreateBuffer(ctx->logical, &bufferInfo, nullptr, &buffer);
+		if (res != VK_SUCCESS) {
+			delete group;
+			return ResultTy::Error({res, VKMINI_FAILED_TO_CREATE_BUFFER});
+		}
+		group->buffers.push_back(buffer);
+		group->sizes.push_back(spec.size);
+
+		VkMemoryRequirements memReq;
+		vkGetBufferMemoryRequirements(ctx->logical, buffer, &memReq);
+		auto memTy = find_memory_type_in(memProperties, memReq.memoryTypeBits, spec.flags);
+		if (!memTy.has_value()) {
+			delete group;
+			return ResultTy::Error({VK_ERROR_UNKNOWN, VKMINI_FAILED_TO_FIND_SUITABLE_MEMORY_TYPE});
+		}
+		auto         index  = (u32)allocationTypes.size();
+		VkDeviceSize offset = 0;
+		for (u32 i = 0; i < allocationTypes.size(); i++) {
+			if (allocationTypes[i] != memTy.value()) {
+				continue;
+			}
+			auto aligned = (allocationSizes[i] + memReq.alignment - 1) / memReq.alignment * memReq.alignment;
+			if (aligned + memReq.size <= maintenance3.maxMemoryAllocationSize) {
+				index  = i;
+				offset = aligned;
+				break;
+			}
+		}
+		if (index == allocationTypes.size()) {
+			allocationTypes.push_back(memTy.value());
+			allocationSizes.push_back(0);
+		}
+		allocationSizes[index] = offset + memReq.size;
+		group->offsets.push_back(offset);
+		group->memoryIndices.push_back(index);
+	}
+
+	group->memories.reserve(allocationTypes.size());
+	for (usize i = 0; i < allocationTypes.size(); i++) {
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize  = allocationSizes[i];
+		allocInfo.memoryTypeIndex = allocationTypes[i];
+		VkDeviceMemory memory;
+		auto           res = vkAllocateMemory(ctx->logical, &allocInfo, nullptr, &memory);
+		if (res != VK_SUCCESS) {
+			delete group;
+			return ResultTy::Error({res, VKMINI_FAILED_TO_ALLOCATE_BUFFER_MEMORY});
+		}
+		group->memories.push_back(memory);
+	}
+
+	if (!specs.empty()) {
+		Vec<VkBindBufferMemoryInfo> bindInfos(specs.size());
+		for (usize i = 0; i < specs.size(); i++) {
+			bindInfos[i].sType        = VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO;
+			bindInfos[i].buffer       = group->buffers[i];
+			bindInfos[i].memory       = group->memories[group->memoryIndices[i]];
+			bindInfos[i].memoryOffset = group->offsets[i];
+		}
+		auto res = vkBindBufferMemory2(ctx->logical, (u32)bindInfos.size(), bindInfos.data());
+		if (res != VK_SUCCESS) {
+			delete group;
+			return ResultTy::Error({res, VKMINI_FAILED_TO_BIND_BUFFER_MEMORY});
+		}
+	}
+	group->accessStates.resize(specs.size());
+
+	{
+		LockGuard<Th> lock(BasicCtxTy<Th>::globalMutex);
+		all_buffer_groups().push_back(group);
+	}
+	return ResultTy::Ok(group);
+}
+
+template <typename Th> BasicBufferGroupTy<Th>::~BasicBufferGroupTy() {
+	for (auto buffer : buffers) {
+		vkDestroyBuffer(ctx->logical, buffer, nullptr);
+	}
+	for (auto memory : memories) {
+		vkFreeMemory(ctx->logical, memory, nullptr);
+	}
 }
 
-VkResult BufferTy::map_memory() {
+template <typename Th> VkResult BasicBufferTy<Th>::map_memory() {
 	if (mapping == nullptr) {
 		auto res = vkMapMemory(ctx->logical, memory, 0, size, 0, &mapping);
 		if (res != VK_SUCCESS) {
@@ -85,14 +333,14 @@ VkResult BufferTy::map_memory() {
 	return VK_SUCCESS;
 }
 
-void BufferTy::unmap_memory() {
+template <typename Th> void BasicBufferTy<Th>::unmap_memory() {
 	if (mapping != nullptr) {
 		vkUnmapMemory(ctx->logical, memory);
 		mapping = nullptr;
 	}
 }
 
-ErrorPair BufferTy::copy_unchecked_from(void* data) {
+template <typename Th> ErrorPair BasicBufferTy<Th>::copy_unchecked_from(void* data) {
 	auto res = map_memory();
 	if (res != VK_SUCCESS) {
 		return {res, VKMINI_FAILED_TO_MAP_MEMORY};
@@ -102,14 +350,28 @@ ErrorPair BufferTy::copy_unchecked_from(void* data) {
 	return {VK_SUCCESS, VKMINI_NO_ERROR};
 }
 
-ErrorPair BufferTy::copy_to(BufferTy destination) const {
-	if (size != destination.size) {
+template <typename Th> ErrorPair BasicBufferTy<Th>::copy_to(BasicBuffer<Th> destination) const {
+	if (size != destination->size) {
 		return {VK_ERROR_UNKNOWN, VKMINI_BUFFER_SIZE_MISMATCH};
 	}
-	return copy_to_vk_buffer_unchecked(destination.buffer);
+	return copy_to_vk_buffer(destination->buffer,
+	                         destination->declare_access(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT));
 }
 
-ErrorPair BufferTy::copy_to_vk_buffer_unchecked(VkBuffer destination) const {
+template <typename Th> ErrorPair BasicBufferTy<Th>::copy_to_vk_buffer_unchecked(VkBuffer destination) const {
+	return copy_to_vk_buffer(destination, None);
+}
+
+template <typename Th> ErrorPair BasicBufferTy<Th>::copy_to_vk_buffer_unchecked(BufferAccess destination) const {
+	destination.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	destination.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+	destination.offset = 0;
+	destination.size   = size;
+	return copy_to_vk_buffer(destination.buffer, destination);
+}
+
+template <typename Th>
+ErrorPair BasicBufferTy<Th>::copy_to_vk_buffer(VkBuffer destination, Maybe<BufferAccess> destinationAccess) const {
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -127,9 +389,27 @@ ErrorPair BufferTy::copy_to_vk_buffer_unchecked(VkBuffer destination) const {
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	res             = vkBeginCommandBuffer(copyCommandBuffer, &beginInfo);
 	if (res != VK_SUCCESS) {
+		vkFreeCommandBuffers(ctx->logical, ctx->commandPool, 1, &copyCommandBuffer);
 		return {res, VKMINI_FAILED_TO_BEGIN_COMMAND_BUFFER};
 	}
 
+	Vec<BufferAccess> accesses{declare_access(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT)};
+	if (destinationAccess.has_value()) {
+		accesses.push_back(destinationAccess.value());
+	}
+	// The tracked state is restored if the copy is never submitted
+	Vec<BufferAccessState> previousStates;
+	for (auto const& access : accesses) {
+		previousStates.push_back(*access.state);
+	}
+	auto discardCopy = [&]() {
+		for (usize i = 0; i < accesses.size(); i++) {
+			*accesses[i].state = previousStates[i];
+		}
+		vkFreeCommandBuffers(ctx->logical, ctx->commandPool, 1, &copyCommandBuffer);
+	};
+	cmd_sync_buffer_accesses(copyCommandBuffer, accesses);
+
 	VkBufferCopy copyRegion{};
 	copyRegion.srcOffset = 0;
 	copyRegion.dstOffset = 0;
@@ -138,6 +418,7 @@ ErrorPair BufferTy::copy_to_vk_buffer_unchecked(VkBuffer destination) const {
 
 	res = vkEndCommandBuffer(copyCommandBuffer);
 	if (res != VK_SUCCESS) {
+		discardCopy();
 		return {res, VKMINI_FAILED_TO_END_COMMAND_BUFFER};
 	}
 
@@ -147,24 +428,27 @@ ErrorPair BufferTy::copy_to_vk_buffer_unchecked(VkBuffer destination) const {
 	submitInfo.pCommandBuffers    = &copyCommandBuffer;
 	res                           = vkQueueSubmit(ctx->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
 	if (res != VK_SUCCESS) {
+		discardCopy();
 		return {res, VKMINI_FAILED_TO_SUBMIT_COMMAND_BUFFER};
 	}
 	res = vkQueueWaitIdle(ctx->graphicsQueue);
+	vkFreeCommandBuffers(ctx->logical, ctx->commandPool, 1, &copyCommandBuffer);
 	if (res != VK_SUCCESS) {
 		return {res, VKMINI_FAILED_WAITING_FOR_QUEUE_TO_FINISH};
 	}
-	vkFreeCommandBuffers(ctx->logical, ctx->commandPool, 1, &copyCommandBuffer);
 
 	return {VK_SUCCESS, VKMINI_NO_ERROR};
 }
 
-BufferTy::~BufferTy() {
+template <typename Th> BasicBufferTy<Th>::~BasicBufferTy() {
 	unmap_memory();
 	vkDestroyBuffer(ctx->logical, buffer, nullptr);
 	vkFreeMemory(ctx->logical, memory, nullptr);
 }
 
-Result<CommandBuffer, ErrorPair> CommandBufferTy::create(Ctx ctx, VkCommandBufferLevel level) {
+template <typename Th>
+Result<BasicCommandBuffer<Th>, ErrorPair> BasicCommandBufferTy<Th>::create(BasicCtx<Th>         ctx,
+                                                                           VkCommandBufferLevel level) {
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.commandPool        = ctx->commandPool;
@@ -173,16 +457,18 @@ Result<CommandBuffer, ErrorPair> CommandBufferTy::create(Ctx ctx, VkCommandBuffe
 	VkCommandBuffer buffer;
 	auto            res = vkAllocateCommandBuffers(ctx->logical, &allocInfo, &buffer);
 	if (res != VK_SUCCESS) {
-		return Result<CommandBuffer, ErrorPair>::Error({res, VKMINI_FAILED_TO_ALLOCATE_COMMAND_BUFFER});
+		return Result<BasicCommandBuffer<Th>, ErrorPair>::Error({res, VKMINI_FAILED_TO_ALLOCATE_COMMAND_BUFFER});
+	}
+	auto bufferResult = new BasicCommandBufferTy(ctx, buffer);
+	{
+		LockGuard<Th> lock(BasicCtxTy<Th>::globalMutex);
+		all_command_buffers().push_back(bufferResult);
 	}
-	auto bufferResult = new CommandBufferTy(ctx, buffer);
-
-	VKMINI_INSIDE_LOCK(allCommandBuffers.push_back(bufferResult);)
 
-	return Result<CommandBuffer, ErrorPair>::Ok(bufferResult);
+	return Result<BasicCommandBuffer<Th>, ErrorPair>::Ok(bufferResult);
 }
 
-ErrorPair CommandBufferTy::begin(VkCommandBufferUsageFlags flags) {
+template <typename Th> ErrorPair BasicCommandBufferTy<Th>::begin(VkCommandBufferUsageFlags flags) {
 	switch (state) {
 		case CommandBufferState::NONE: {
 			VkCommandBufferBeginInfo beginInfo{};
@@ -206,7 +492,8 @@ ErrorPair CommandBufferTy::begin(VkCommandBufferUsageFlags flags) {
 	return {VK_SUCCESS, VKMINI_NO_ERROR};
 }
 
-ErrorCode CommandBufferTy::record(std::function<void(VkCommandBuffer)> callback) {
+template <typename Th>
+ErrorCode BasicCommandBufferTy<Th>::record(std::function<void(VkCommandBuffer)> callback) {
 	switch (state) {
 		case CommandBufferState::RECORDING:
 		case CommandBufferState::BEGUN: {
@@ -222,7 +509,23 @@ ErrorCode CommandBufferTy::record(std::function<void(VkCommandBuffer)> callback)
 	return VKMINI_NO_ERROR;
 }
 
-ErrorPair CommandBufferTy::end() {
+template <typename Th> ErrorCode BasicCommandBufferTy<Th>::sync_accesses(Vec<BufferAccess> const& accesses) {
+	switch (state) {
+		case CommandBufferState::RECORDING:
+		case CommandBufferState::BEGUN: {
+			cmd_sync_buffer_accesses(buffer, accesses);
+			state = CommandBufferState::RECORDING;
+			return VKMINI_NO_ERROR;
+		}
+		case CommandBufferState::END:
+			return VKMINI_COMMAND_BUFFER_ALREADY_ENDED;
+		case CommandBufferState::NONE:
+			return VKMINI_COMMAND_BUFFER_HAS_NOT_BEGUN;
+	}
+	return VKMINI_NO_ERROR;
+}
+
+template <typename Th> ErrorPair BasicCommandBufferTy<Th>::end() {
 	switch (state) {
 		case CommandBufferState::BEGUN:
 		case CommandBufferState::RECORDING: {
@@ -241,7 +544,8 @@ ErrorPair CommandBufferTy::end() {
 	return {VK_SUCCESS, VKMINI_NO_ERROR};
 }
 
-ErrorPair CommandBufferTy::submit(VkQueue graphicsQueue, std::optional<VkFence> fence) {
+template <typename Th>
+ErrorPair BasicCommandBufferTy<Th>::submit(VkQueue graphicsQueue, std::optional<VkFence> fence) {
 	switch (state) {
 		case CommandBufferState::END: {
 			VkSubmitInfo submitInfo{};
@@ -264,8 +568,9 @@ ErrorPair CommandBufferTy::submit(VkQueue graphicsQueue, std::optional<VkFence>
 	return {VK_SUCCESS, VKMINI_NO_ERROR};
 }
 
-ErrorPair CommandBufferTy::perform(std::function<void(VkCommandBuffer)> callback, VkQueue graphicsQueue,
-                                   VkCommandBufferUsageFlags flags, VkFence fence) {
+template <typename Th>
+ErrorPair BasicCommandBufferTy<Th>::perform(std::function<void(VkCommandBuffer)> callback, VkQueue graphicsQueue,
+                                            VkCommandBufferUsageFlags flags, VkFence fence) {
 	auto resPair = begin(flags);
 	if (resPair.vulkan != VK_SUCCESS) {
 		return resPair;
@@ -285,6 +590,20 @@ ErrorPair CommandBufferTy::perform(std::function<void(VkCommandBuffer)> callback
 	return {VK_SUCCESS, VKMINI_NO_ERROR};
 }
 
-CommandBufferTy::~CommandBufferTy() { vkFreeCommandBuffers(ctx->logical, ctx->commandPool, 1, &buffer); }
+template <typename Th> BasicCommandBufferTy<Th>::~BasicCommandBufferTy() {
+	vkFreeCommandBuffers(ctx->logical, ctx->commandPool, 1, &buffer);
+}
+
+template class BasicCtxTy<MultiThread>;
+template class BasicCtxTy<SingleThread>;
+template class BasicBufferTy<MultiThread>;
+template class BasicBufferTy<SingleThread>;
+template class BasicBufferGroupTy<MultiThread>;
+template class BasicBufferGroupTy<SingleThread>;
+template class BasicCommandBufferTy<MultiThread>;
+template class BasicCommandBufferTy<SingleThread>;
+
+template Maybe<u32> find_memory_type<MultiThread>(BasicCtx<MultiThread>, u32, VkMemoryPropertyFlags);
+template Maybe<u32> find_memory_type<SingleThread>(BasicCtx<SingleThread>, u32, VkMemoryPropertyFlags);
 
 } // namespace vk